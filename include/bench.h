@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CALLS_PATTERN "%n" // in the target arguments, replaced by the number of hooked calls
+
+// The values measured for one execution of a binary
+enum bench_metric
+{
+    M_WALL,     // fork to exit, in microseconds
+    M_CPU,      // user + system time, in microseconds
+    M_MINFLT,   // minor page faults
+    M_MAJFLT,   // major page faults
+    M_CYCLES,   // user space cpu cycles (perf)
+    M_INSTR,    // user space instructions (perf)
+    M_ITLB,     // user space iTLB misses (perf)
+    NB_METRICS
+};
+
+struct bench_run
+{
+    double values[NB_METRICS];
+    bool valid[NB_METRICS]; // false if the counter is not supported by this machine
+    int status;             // as returned by wait4
+};
+
+int bench_exec(char *const [], struct bench_run *);
+int count_mappings(char *const []);
+const char *bench_metric_name(enum bench_metric);
+void describe_status(int, char *, size_t);
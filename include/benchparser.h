@@ -0,0 +1,22 @@
+#pragma once
+
+#include <argp.h>
+#include <stdbool.h>
+
+extern struct argp_option bench_opts[];
+extern struct argp bench_argp;
+error_t parse_bench_opt(int, char *, struct argp_state *);
+
+// The structure that will control if the argument had been set
+
+struct bench_arguments
+{
+    char * original;          // the binary before injection
+    char * patched;           // the same binary after isos-inject
+    char ** target_args;      // the arguments given to both binaries
+    int nb_target_args;       // number of target_args
+    char * runs;              // number of measured runs of each binary
+    char * warmup;            // number of runs done before measuring
+    char * calls;             // number of hooked calls, replaces CALLS_PATTERN in the target arguments
+    char * max_regression;    // fail if the startup latency of patched is surely more than this % above original
+};
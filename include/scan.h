@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#define SCAN_PAGE      4096
+#define SCAN_MAX_READ  (16 * 1024 * 1024) // upper bound of a single section read, protects against corrupted headers
+#define SCAN_NO_IMPORT "-"
+
+// Capabilities of a scanned file, one bit per check done by isos-inject
+#define CAP_EXEC   0x1 // ELF64 x86-64 ET_EXEC (what verify_binary accepts)
+#define CAP_PTNOTE 0x2 // a PT_NOTE segment exists (find_pt_note_index)
+#define CAP_ABITAG 0x4 // a .note.ABI-tag section exists (overwrite_section_hdr)
+#define CAP_GOT    0x8 // .rela.plt, .dynsym, .dynstr and .got.plt exist (replace_in_got)
+
+// What the entrypoint injection (-b 1) needs
+#define CAP_INJECT_EP  (CAP_EXEC | CAP_PTNOTE | CAP_ABITAG)
+// What the got injection (-b 0 -d func) needs, func has to be in the imports too
+#define CAP_INJECT_GOT (CAP_INJECT_EP | CAP_GOT)
+
+// One line of the index
+struct scan_entry
+{
+    char * path;     // the scanned file
+    off_t size;      // its size when it was scanned
+    uint64_t hash;   // FNV-1a fingerprint of the header bytes read
+    unsigned caps;   // CAP_* flags
+    char * imports;  // comma separated names of the .rela.plt imports, NULL if none
+};
+
+int scan_file(const char *, struct scan_entry *);
+void scan_entry_free(struct scan_entry *);
+void scan_path_print(FILE *, const char *);
+void scan_entry_print(FILE *, const struct scan_entry *);
+int scan_entry_parse(char *, struct scan_entry *);
+bool scan_entry_has_import(const struct scan_entry *, const char *);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <argp.h>
+#include <stdbool.h>
+
+extern struct argp_option scan_opts[];
+extern struct argp scan_argp;
+error_t parse_scan_opt(int, char *, struct argp_state *);
+
+// The structure that will control if the argument had been set
+
+struct scan_arguments
+{
+    char ** paths;            // the files and directories to scan
+    int nb_paths;             // number of paths
+    char * output_file;       // where to write the index (stdout if NULL)
+    char * jobs;              // number of scanning threads
+    char * index_file;        // query this index instead of scanning
+    char * func_to_replace;   // with -q: only list the files where this function can be hooked
+    bool rescan;              // with -q: scan the files again to check they didn't change
+};
@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define EXEC_FAILED 127
+
+// The perf counters we open on the child, in the order of enum bench_metric from M_CYCLES
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} perf_counters[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_ITLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+#define NB_PERF_COUNTERS (sizeof(perf_counters) / sizeof(perf_counters[0]))
+
+// once a counter failed to open, we don't try it again on the next runs
+static bool perf_unsupported[NB_PERF_COUNTERS];
+
+static const char *metric_names[NB_METRICS] = {
+    [M_WALL] = "latency (us)",
+    [M_CPU] = "cpu time (us)",
+    [M_MINFLT] = "minor faults",
+    [M_MAJFLT] = "major faults",
+    [M_CYCLES] = "cycles",
+    [M_INSTR] = "instructions",
+    [M_ITLB] = "iTLB misses",
+};
+
+const char *bench_metric_name(enum bench_metric metric) {
+    return metric_names[metric];
+}
+
+void describe_status(int status, char *buf, size_t len) {
+    // human readable form of a wait4 status
+    if (WIFSIGNALED(status)) {
+        snprintf(buf, len, "signal %d (%s)", WTERMSIG(status), strsignal(WTERMSIG(status)));
+    }
+    else {
+        snprintf(buf, len, "exit status %d", WEXITSTATUS(status));
+    }
+}
+
+static int open_counter(pid_t pid, size_t i) {
+    // the counter starts when the child calls execve, and counts the threads it creates
+    // user space only, so that it works with the default perf_event_paranoid
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_counters[i].type;
+    attr.config = perf_counters[i].config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void exec_child(int sync_fd, int err_fd, char *const argv[]) {
+    // wait for the parent to set the counters, then run the target without its output
+    // err_fd is closed by a successful execv, otherwise errno is sent through it
+    char c;
+    int exec_errno;
+    if (read(sync_fd, &c, 1) != 1) {
+        exec_errno = EPIPE;
+        write(err_fd, &exec_errno, sizeof(exec_errno));
+        _exit(EXEC_FAILED);
+    }
+    close(sync_fd);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd != -1) {
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+    execv(argv[0], argv);
+    exec_errno = errno;
+    write(err_fd, &exec_errno, sizeof(exec_errno));
+    _exit(EXEC_FAILED);
+}
+
+// Run argv once and fill run with what it cost and how it ended.
+// Return -1 and set errno if the binary couldn't be executed
+int bench_exec(char *const argv[], struct bench_run *run) {
+    int sync_pipe[2];
+    int err_pipe[2];
+    if (pipe2(sync_pipe, O_CLOEXEC) == -1 || pipe2(err_pipe, O_CLOEXEC) == -1) {
+        errx(EXIT_FAILURE, "Error: bench_exec: pipe failed");
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        errx(EXIT_FAILURE, "Error: bench_exec: fork failed");
+    }
+    if (pid == 0) {
+        close(sync_pipe[1]);
+        close(err_pipe[0]);
+        exec_child(sync_pipe[0], err_pipe[1], argv);
+    }
+    close(sync_pipe[0]);
+    close(err_pipe[1]);
+
+    int counters[NB_PERF_COUNTERS];
+    for (size_t i = 0; i < NB_PERF_COUNTERS; i++) {
+        counters[i] = perf_unsupported[i] ? -1 : open_counter(pid, i);
+        if (counters[i] == -1) {
+            perf_unsupported[i] = true;
+        }
+    }
+
+    struct timespec start, stop;
+    struct rusage usage;
+    int status;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (write(sync_pipe[1], "", 1) != 1) {
+        errx(EXIT_FAILURE, "Error: bench_exec: couldn't start the child");
+    }
+    close(sync_pipe[1]);
+    if (wait4(pid, &status, 0, &usage) == -1) {
+        errx(EXIT_FAILURE, "Error: bench_exec: wait4 failed");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    run->values[M_WALL] = (stop.tv_sec - start.tv_sec) * 1e6 + (stop.tv_nsec - start.tv_nsec) / 1e3;
+    run->values[M_CPU] = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+    run->values[M_MINFLT] = usage.ru_minflt;
+    run->values[M_MAJFLT] = usage.ru_majflt;
+    for (int m = M_WALL; m <= M_MAJFLT; m++) {
+        run->valid[m] = true;
+    }
+
+    // the counters of an exited task keep their final value
+    for (size_t i = 0; i < NB_PERF_COUNTERS; i++) {
+        uint64_t count;
+        run->valid[M_CYCLES + i] = counters[i] != -1 && read(counters[i], &count, sizeof(count)) == sizeof(count);
+        run->values[M_CYCLES + i] = run->valid[M_CYCLES + i] ? count : 0;
+        if (counters[i] != -1) {
+            close(counters[i]);
+        }
+    }
+
+    // nothing to read if execv succeeded, whatever the exit status of the target is
+    int exec_errno;
+    ssize_t r = read(err_pipe[0], &exec_errno, sizeof(exec_errno));
+    close(err_pipe[0]);
+    if (r == sizeof(exec_errno)) {
+        errno = exec_errno;
+        return -1;
+    }
+    run->status = status;
+    return 0;
+}
+
+static int count_lines(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+    FILE *maps = fopen(path, "r");
+    if (maps == NULL) {
+        return -1;
+    }
+    int nb_lines = 0;
+    int c;
+    while ((c = fgetc(maps)) != EOF) {
+        if (c == '\n') {
+            nb_lines++;
+        }
+    }
+    fclose(maps);
+    return nb_lines;
+}
+
+// Run argv once under ptrace and return the number of memory mappings it has just before exiting,
+// -1 if it can't be traced. It is not done in bench_exec because the tracing would be measured too
+int count_mappings(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        errx(EXIT_FAILURE, "Error: count_mappings: fork failed");
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            close(null_fd);
+        }
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1) {
+            _exit(EXEC_FAILED);
+        }
+        // the child stops with SIGTRAP after execv
+        execv(argv[0], argv);
+        _exit(EXEC_FAILED);
+    }
+
+    int status;
+    int nb_mappings = -1;
+    if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status)) {
+        return -1;
+    }
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)(PTRACE_O_TRACEEXIT | PTRACE_O_EXITKILL));
+    ptrace(PTRACE_CONT, pid, NULL, NULL);
+
+    while (waitpid(pid, &status, 0) != -1 && WIFSTOPPED(status)) {
+        int sig = 0;
+        if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXIT << 8))) {
+            // the task is exiting but its memory is still there
+            nb_mappings = count_lines(pid);
+        }
+        else if (WSTOPSIG(status) != SIGTRAP) {
+            // give back the signals that are not for us
+            sig = WSTOPSIG(status);
+        }
+        ptrace(PTRACE_CONT, pid, NULL, (void *)(intptr_t)sig);
+    }
+    return nb_mappings;
+}
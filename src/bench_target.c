@@ -0,0 +1,15 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// Synthetic victim for isos-bench: calls getenv argv[1] times.
+// Built as a non-PIE, lazily bound executable so that isos-inject can hook getenv in the got.
+int main(int argc, char *argv[]) {
+    long nb_calls = (argc > 1) ? strtol(argv[1], NULL, 0) : 0;
+    char *volatile sink;
+
+    for (long i = 0; i < nb_calls; i++) {
+        sink = getenv("HOME");
+    }
+    (void)sink;
+    return 0;
+}
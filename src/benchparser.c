@@ -0,0 +1,59 @@
+#include <argp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "benchparser.h"
+
+struct argp_option bench_opts[] = {
+    {"runs", 'n', "UINT", 0, "The number of measured runs of each binary (default: 100)", 0},
+    {"warmup", 'w', "UINT", 0, "The number of runs done before measuring, to warm the page cache (default: 5)", 0},
+    {"calls", 'c', "UINT", 0, "Measure the cost of a hooked call: the targets are run with '%n' replaced by 0 and by UINT in ARGS", 0},
+    {"max-regression", 'g', "PERCENT", 0, "Exit with an error if the startup latency of PATCHED is above the one of ORIGINAL by more than PERCENT, confidence interval included", 0},
+    {0}
+};
+
+error_t parse_bench_opt(int k, char *arg, struct argp_state *state) {
+    // Take the current parsed argument
+    struct bench_arguments *argstruct = state->input;
+    switch (k) {
+        case 'n': {
+            argstruct->runs = arg;
+            break;
+        }
+        case 'w': {
+            argstruct->warmup = arg;
+            break;
+        }
+        case 'c': {
+            argstruct->calls = arg;
+            break;
+        }
+        case 'g': {
+            argstruct->max_regression = arg;
+            break;
+        }
+        case ARGP_KEY_ARGS:
+            if (state->argc - state->next < 2) {
+                argp_usage(state);
+            }
+            argstruct->original = state->argv[state->next];
+            argstruct->patched = state->argv[state->next + 1];
+            argstruct->target_args = &state->argv[state->next + 2];
+            argstruct->nb_target_args = state->argc - state->next - 2;
+            break;
+        case ARGP_KEY_NO_ARGS:
+            argp_usage(state);
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+struct argp bench_argp = {bench_opts, parse_bench_opt, "ORIGINAL PATCHED [-- ARGS...]", "This program measures what the injection "
+"costs to the patched binary.\nORIGINAL and PATCHED are run alternately with ARGS, their output is discarded, and for each "
+"metric the mean and its 95% confidence interval are printed, with the difference between the two binaries. "
+"Every run has to end with the same status as the first run of ORIGINAL, and with -g this status has to be 0.\n"
+"With -c CALLS, ARGS has to contain '%n' (the number of times the target calls the hooked function): the per-call "
+"overhead of the hook is the difference of the slopes between 0 and CALLS calls.", 0, 0, 0};
@@ -0,0 +1,270 @@
+#include <argp.h>
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "benchparser.h"
+
+#define DEFAULT_RUNS   100
+#define DEFAULT_WARMUP 5
+#define Z_95           1.959964 // normal quantile for a 95% two-sided interval
+
+// The configurations measured, the CALLS ones only with -c
+enum bench_config
+{
+    ORIG_STARTUP,
+    PATCHED_STARTUP,
+    ORIG_CALLS,
+    PATCHED_CALLS,
+    NB_CONFIGS
+};
+
+struct summary
+{
+    double mean;
+    double var;   // variance of the samples
+    int n;
+    bool valid;
+};
+
+// Student's t quantile for a 95% two-sided interval, for 1 to 30 degrees of freedom
+static const double t_95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double t_quantile(int df) {
+    if (df < 1) {
+        return NAN;
+    }
+    if (df <= 30) {
+        return t_95[df - 1];
+    }
+    // Cornish-Fisher expansion of the t quantile around the normal one, the error is below 1e-4 from 31 degrees of freedom
+    double z = Z_95;
+    double z3 = z * z * z;
+    double z5 = z3 * z * z;
+    double z7 = z5 * z * z;
+    double n = df;
+    return z + (z3 + z) / (4 * n) + (5 * z5 + 16 * z3 + 3 * z) / (96 * n * n)
+           + (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384 * n * n * n);
+}
+
+static long parse_uint(char *arg, char *name, long def) {
+    if (arg == NULL) {
+        return def;
+    }
+    char *err_strtol;
+    long tmp = strtol(arg, &err_strtol, 0);
+    if (*err_strtol != '\0' || tmp < 0) {
+        errx(EXIT_FAILURE, "Error: Argument %s has to be an integer >= 0", name);
+    }
+    return tmp;
+}
+
+static char **make_argv(char *binary, char **args, int nb_args, char *calls) {
+    // binary followed by args, where CALLS_PATTERN is replaced by calls
+    char **argv = calloc(nb_args + 2, sizeof(char *));
+    if (argv == NULL) {
+        errx(EXIT_FAILURE, "Error: make_argv: calloc failed");
+    }
+    argv[0] = binary;
+    for (int i = 0; i < nb_args; i++) {
+        argv[i + 1] = (calls != NULL && strcmp(args[i], CALLS_PATTERN) == 0) ? calls : args[i];
+    }
+    return argv;
+}
+
+static struct summary summarize(struct bench_run *runs, int n, enum bench_metric m) {
+    struct summary s = {0, 0, n, true};
+    for (int i = 0; i < n; i++) {
+        s.valid = s.valid && runs[i].valid[m];
+        s.mean += runs[i].values[m];
+    }
+    s.mean /= n;
+    for (int i = 0; i < n; i++) {
+        s.var += (runs[i].values[m] - s.mean) * (runs[i].values[m] - s.mean);
+    }
+    s.var = (n > 1) ? s.var / (n - 1) : 0;
+    return s;
+}
+
+static double ci(struct summary s) {
+    // half width of the 95% confidence interval of the mean
+    return t_quantile(s.n - 1) * sqrt(s.var / s.n);
+}
+
+static void print_startup(struct bench_run **runs, int n, int *mappings) {
+    printf("%-16s%26s%26s%26s\n", "startup", "original", "patched", "difference");
+    for (int m = 0; m < NB_METRICS; m++) {
+        struct summary o = summarize(runs[ORIG_STARTUP], n, m);
+        struct summary p = summarize(runs[PATCHED_STARTUP], n, m);
+        if (!o.valid || !p.valid) {
+            printf("%-16s%26s%26s%26s\n", bench_metric_name(m), "n/a", "n/a", "n/a");
+            continue;
+        }
+        // both binaries have the same number of runs, so n - 1 degrees of freedom is conservative
+        double diff = p.mean - o.mean;
+        double diff_ci = t_quantile(n - 1) * sqrt(o.var / n + p.var / n);
+        printf("%-16s%14.1f +/- %-7.1f%14.1f +/- %-7.1f%+14.1f +/- %-7.1f (%+.1f%%)\n", bench_metric_name(m),
+               o.mean, ci(o), p.mean, ci(p), diff, diff_ci, (o.mean != 0) ? 100 * diff / o.mean : 0.0);
+    }
+    if (mappings[0] == -1 || mappings[1] == -1) {
+        printf("%-16s%26s%26s%26s\n", "mappings", "n/a", "n/a", "n/a");
+    }
+    else {
+        // aligned with the means of the other rows
+        printf("%-16s%14d%12s%14d%12s%+14d\n", "mappings", mappings[0], "", mappings[1], "", mappings[1] - mappings[0]);
+    }
+}
+
+static void print_per_call(struct bench_run **runs, int n, long calls) {
+    // the cost of one call is the slope between 0 and calls calls, the hook overhead is the difference of the slopes
+    printf("\n%-16s%26s%26s%26s\n", "per hooked call", "original", "patched", "overhead");
+    enum bench_metric metrics[] = {M_WALL, M_CPU, M_CYCLES, M_INSTR, M_ITLB};
+    for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++) {
+        enum bench_metric m = metrics[i];
+        struct summary s[NB_CONFIGS];
+        bool valid = true;
+        for (int c = 0; c < NB_CONFIGS; c++) {
+            s[c] = summarize(runs[c], n, m);
+            valid = valid && s[c].valid;
+        }
+        if (!valid) {
+            printf("%-16s%26s%26s%26s\n", bench_metric_name(m), "n/a", "n/a", "n/a");
+            continue;
+        }
+        double t = t_quantile(n - 1);
+        double o = (s[ORIG_CALLS].mean - s[ORIG_STARTUP].mean) / calls;
+        double o_ci = t * sqrt((s[ORIG_CALLS].var + s[ORIG_STARTUP].var) / n) / calls;
+        double p = (s[PATCHED_CALLS].mean - s[PATCHED_STARTUP].mean) / calls;
+        double p_ci = t * sqrt((s[PATCHED_CALLS].var + s[PATCHED_STARTUP].var) / n) / calls;
+        double diff_ci = t * sqrt((s[ORIG_CALLS].var + s[ORIG_STARTUP].var + s[PATCHED_CALLS].var + s[PATCHED_STARTUP].var) / n) / calls;
+        printf("%-16s%14.4f +/- %-7.4f%14.4f +/- %-7.4f%+14.4f +/- %-7.4f\n", bench_metric_name(m),
+               o, o_ci, p, p_ci, p - o, diff_ci);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct bench_arguments args = {
+        .original = NULL,
+        .patched = NULL,
+        .target_args = NULL,
+        .nb_target_args = 0,
+        .runs = NULL,
+        .warmup = NULL,
+        .calls = NULL,
+        .max_regression = NULL
+    };
+
+    argp_parse(&bench_argp, argc, argv, 0, 0, &args);
+
+    long nb_runs = parse_uint(args.runs, "-n --runs", DEFAULT_RUNS);
+    long nb_warmup = parse_uint(args.warmup, "-w --warmup", DEFAULT_WARMUP);
+    long calls = parse_uint(args.calls, "-c --calls", 0);
+    if (nb_runs < 2) {
+        errx(EXIT_FAILURE, "Error: Argument -n --runs has to be >= 2 to compute a confidence interval");
+    }
+    double max_regression = NAN;
+    if (args.max_regression != NULL) {
+        char *err_strtod;
+        max_regression = strtod(args.max_regression, &err_strtod);
+        if (*err_strtod != '\0') {
+            errx(EXIT_FAILURE, "Error: Argument -g --max-regression has to be a number");
+        }
+    }
+
+    int nb_configs = PATCHED_STARTUP + 1;
+    if (args.calls != NULL) {
+        bool has_pattern = false;
+        for (int i = 0; i < args.nb_target_args; i++) {
+            has_pattern = has_pattern || strcmp(args.target_args[i], CALLS_PATTERN) == 0;
+        }
+        if (!has_pattern || calls == 0) {
+            errx(EXIT_FAILURE, "Error: Argument -c --calls has to be > 0 and ARGS has to contain '%s'", CALLS_PATTERN);
+        }
+        nb_configs = NB_CONFIGS;
+    }
+
+    char **target_argv[NB_CONFIGS];
+    target_argv[ORIG_STARTUP] = make_argv(args.original, args.target_args, args.nb_target_args, "0");
+    target_argv[PATCHED_STARTUP] = make_argv(args.patched, args.target_args, args.nb_target_args, "0");
+    target_argv[ORIG_CALLS] = make_argv(args.original, args.target_args, args.nb_target_args, args.calls);
+    target_argv[PATCHED_CALLS] = make_argv(args.patched, args.target_args, args.nb_target_args, args.calls);
+
+    struct bench_run *runs[NB_CONFIGS];
+    for (int c = 0; c < NB_CONFIGS; c++) {
+        runs[c] = calloc(nb_runs, sizeof(struct bench_run));
+        if (runs[c] == NULL) {
+            errx(EXIT_FAILURE, "Error: main: calloc failed");
+        }
+    }
+
+#ifdef DEBUG
+    printf("Debug: main: %ld runs, %ld warmup, %d configurations, %ld calls\n", nb_runs, nb_warmup, nb_configs, calls);
+#endif
+
+    // The configurations are run alternately, so that a change of the machine state affects all of them the same way.
+    // Every run has to end like the first run of the original with the same arguments: a payload that makes the patched
+    // binary exit early would look like a faster startup
+    struct bench_run trash;
+    int expected_status[NB_CONFIGS];
+    char status_str[2][64];
+    for (long r = -nb_warmup; r < nb_runs; r++) {
+        for (int c = 0; c < nb_configs; c++) {
+            struct bench_run *run = (r < 0) ? &trash : &runs[c][r];
+            if (bench_exec(target_argv[c], run) == -1) {
+                err(EXIT_FAILURE, "Error: '%s' couldn't be executed", target_argv[c][0]);
+            }
+            // ORIG_* comes before PATCHED_* of the same arguments
+            if (r == -nb_warmup && (c == ORIG_STARTUP || c == ORIG_CALLS)) {
+                expected_status[c] = run->status;
+                expected_status[c + 1] = run->status;
+            }
+            if (run->status != expected_status[c]) {
+                describe_status(run->status, status_str[0], sizeof(status_str[0]));
+                describe_status(expected_status[c], status_str[1], sizeof(status_str[1]));
+                errx(EXIT_FAILURE, "Error: '%s' ended with %s instead of %s like the first run of '%s'",
+                     target_argv[c][0], status_str[0], status_str[1], args.original);
+            }
+        }
+    }
+    if (expected_status[ORIG_STARTUP] != 0) {
+        // as a release gate, the timings of a failing run mean nothing
+        describe_status(expected_status[ORIG_STARTUP], status_str[0], sizeof(status_str[0]));
+        if (!isnan(max_regression)) {
+            errx(EXIT_FAILURE, "Error: '%s' ended with %s, -g needs the targets to succeed", args.original, status_str[0]);
+        }
+        warnx("Warning: '%s' ended with %s on every run", args.original, status_str[0]);
+    }
+
+    int mappings[2] = {count_mappings(target_argv[ORIG_STARTUP]), count_mappings(target_argv[PATCHED_STARTUP])};
+
+    printf("isos-bench: %ld runs of '%s' and '%s', means with 95%% confidence intervals\n\n", nb_runs, args.original, args.patched);
+    print_startup(runs, nb_runs, mappings);
+    if (nb_configs == NB_CONFIGS) {
+        print_per_call(runs, nb_runs, calls);
+    }
+
+    int ret = EXIT_SUCCESS;
+    if (!isnan(max_regression)) {
+        struct summary o = summarize(runs[ORIG_STARTUP], nb_runs, M_WALL);
+        struct summary p = summarize(runs[PATCHED_STARTUP], nb_runs, M_WALL);
+        double lower = p.mean - o.mean - t_quantile(nb_runs - 1) * sqrt(o.var / nb_runs + p.var / nb_runs);
+        if (lower > o.mean * max_regression / 100) {
+            fprintf(stderr, "isos-bench: startup latency regression above %.1f%%\n", max_regression);
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    for (int c = 0; c < NB_CONFIGS; c++) {
+        free(runs[c]);
+        free(target_argv[c]);
+    }
+    return ret;
+}
@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+#include <argp.h>
+#include <err.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scan.h"
+#include "scanparser.h"
+
+#define SCAN_BATCH   64  // number of files a thread takes from the list at once
+#define NFTW_FD      64  // number of directories nftw keeps open
+
+// The files found while walking the directories, nftw doesn't let us pass a context
+static struct scan_entry *entries = NULL;
+static size_t nb_entries = 0;
+static size_t cap_entries = 0;
+
+// Shared by the scanning threads
+static atomic_size_t next_entry = 0;
+
+static void add_file(const char *path) {
+    if (nb_entries == cap_entries) {
+        cap_entries = (cap_entries == 0) ? 1024 : cap_entries * 2;
+        entries = realloc(entries, cap_entries * sizeof(struct scan_entry));
+        if (entries == NULL) {
+            errx(EXIT_FAILURE, "Error: add_file: realloc failed");
+        }
+    }
+    memset(&entries[nb_entries], 0, sizeof(struct scan_entry));
+    entries[nb_entries].path = strdup(path);
+    if (entries[nb_entries].path == NULL) {
+        errx(EXIT_FAILURE, "Error: add_file: strdup failed");
+    }
+    nb_entries++;
+}
+
+static int walk_cb(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)ftw;
+    if (type == FTW_F && S_ISREG(st->st_mode)) {
+        add_file(path);
+    }
+    else if (type == FTW_DNR || type == FTW_NS) {
+        warnx("Warning: '%s' skipped, couldn't be read", path);
+    }
+    return 0;
+}
+
+static void *scan_worker(void *arg) {
+    int *nb_failed = arg;
+    size_t begin;
+    // each thread takes a batch of files until the list is empty
+    while ((begin = atomic_fetch_add(&next_entry, SCAN_BATCH)) < nb_entries) {
+        size_t end = (begin + SCAN_BATCH < nb_entries) ? begin + SCAN_BATCH : nb_entries;
+        for (size_t i = begin; i < end; i++) {
+            if (scan_file(entries[i].path, &entries[i]) == -1) {
+                // size == -1 marks the entry as not scanned
+                entries[i].size = -1;
+                (*nb_failed)++;
+            }
+        }
+    }
+    return NULL;
+}
+
+static bool is_up_to_date(struct scan_entry *entry, bool rescan) {
+    // the file must still have the size it had when indexed, and with rescan the same header hash
+    struct stat file_stat;
+    if (stat(entry->path, &file_stat) == -1 || file_stat.st_size != entry->size) {
+        return false;
+    }
+    if (rescan) {
+        struct scan_entry current = {.path = NULL};
+        int err = scan_file(entry->path, &current);
+        free(current.imports);
+        if (err == -1 || current.hash != entry->hash) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int query_index(char *index_file, char *func_name, bool rescan) {
+    // print the files of the index that can be patched, in the same order
+    // the files modified since the index was written are skipped
+    FILE *index = fopen(index_file, "r");
+    if (index == NULL) {
+        errx(EXIT_FAILURE, "Error: query_index: couldn't open '%s' file", index_file);
+    }
+    unsigned caps = (func_name == NULL) ? CAP_INJECT_EP : CAP_INJECT_GOT;
+    char *line = NULL;
+    size_t len = 0;
+    size_t nb_line = 0;
+    size_t nb_stale = 0;
+    struct scan_entry entry;
+
+    while (getline(&line, &len, index) != -1) {
+        nb_line++;
+        if (scan_entry_parse(line, &entry) == -1) {
+            warnx("Warning: '%s' line %zu is malformed", index_file, nb_line);
+            continue;
+        }
+        if ((entry.caps & caps) != caps) {
+            continue;
+        }
+        if (func_name != NULL && !scan_entry_has_import(&entry, func_name)) {
+            continue;
+        }
+        if (!is_up_to_date(&entry, rescan)) {
+            warnx("Warning: '%s' skipped, it changed since '%s' was written", entry.path, index_file);
+            nb_stale++;
+            continue;
+        }
+        // one file per line, escaped like in the index
+        scan_path_print(stdout, entry.path);
+        putchar('\n');
+    }
+    free(line);
+    fclose(index);
+    if (nb_stale > 0) {
+        warnx("Warning: %zu files changed, scan them again to update '%s'", nb_stale, index_file);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct scan_arguments args = {
+        .paths = NULL,
+        .nb_paths = 0,
+        .output_file = NULL,
+        .jobs = NULL,
+        .index_file = NULL,
+        .func_to_replace = NULL,
+        .rescan = false
+    };
+
+    argp_parse(&scan_argp, argc, argv, 0, 0, &args);
+
+    // Verifying that the arguments of the two modes are not mixed
+    if (args.index_file == NULL && (args.func_to_replace != NULL || args.rescan)) {
+        errx(EXIT_FAILURE, "Error: Arguments -d and -r can only be used with -q\n\tisos-scan --usage\t for more informations");
+    }
+    if (args.index_file != NULL && (args.nb_paths > 0 || args.output_file != NULL || args.jobs != NULL)) {
+        errx(EXIT_FAILURE, "Error: PATH, -o and -j can't be used with -q\n\tisos-scan --usage\t for more informations");
+    }
+
+    if (args.index_file != NULL) {
+        return query_index(args.index_file, args.func_to_replace, args.rescan);
+    }
+
+    if (args.nb_paths == 0) {
+        errx(EXIT_FAILURE, "Error: At least one PATH has to be set\n\tisos-scan --usage\t for more informations");
+    }
+
+    long nb_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (args.jobs != NULL) {
+        char *err_strtol;
+        nb_jobs = strtol(args.jobs, &err_strtol, 0);
+        if (*err_strtol != '\0' || nb_jobs <= 0) {
+            errx(EXIT_FAILURE, "Error: Argument -j --jobs has to be > 0");
+        }
+    }
+    if (nb_jobs <= 0) {
+        nb_jobs = 1;
+    }
+
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // First we list all the regular files, without following the symbolic links
+    // except for a PATH given by the user (/bin -> usr/bin on merged /usr systems), FTW_PHYS would skip it
+    for (int i = 0; i < args.nb_paths; i++) {
+        struct stat path_stat;
+        char *path = args.paths[i];
+        char *resolved = NULL;
+        if (lstat(path, &path_stat) == 0 && S_ISLNK(path_stat.st_mode)) {
+            resolved = realpath(path, NULL);
+            if (resolved == NULL) {
+                warnx("Warning: '%s' skipped, it is a broken symbolic link", path);
+                continue;
+            }
+            path = resolved;
+        }
+        if (nftw(path, walk_cb, NFTW_FD, FTW_PHYS) == -1) {
+            warnx("Warning: '%s' skipped, couldn't be walked", args.paths[i]);
+        }
+        free(resolved);
+    }
+
+#ifdef DEBUG
+    printf("Debug: main: %zu files to scan with %ld threads\n", nb_entries, nb_jobs);
+#endif
+
+    // Then the files are scanned in parallel
+    pthread_t *threads = calloc(nb_jobs, sizeof(pthread_t));
+    int *nb_failed = calloc(nb_jobs, sizeof(int));
+    if (threads == NULL || nb_failed == NULL) {
+        errx(EXIT_FAILURE, "Error: main: calloc failed");
+    }
+    for (long i = 0; i < nb_jobs; i++) {
+        if (pthread_create(&threads[i], NULL, scan_worker, &nb_failed[i]) != 0) {
+            errx(EXIT_FAILURE, "Error: main: pthread_create failed");
+        }
+    }
+    int total_failed = 0;
+    for (long i = 0; i < nb_jobs; i++) {
+        pthread_join(threads[i], NULL);
+        total_failed += nb_failed[i];
+    }
+    free(threads);
+    free(nb_failed);
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    // Finally the index is written in the order of the walk, so it is the same from a run to another
+    FILE *out = stdout;
+    if (args.output_file != NULL) {
+        out = fopen(args.output_file, "w");
+        if (out == NULL) {
+            errx(EXIT_FAILURE, "Error: main: couldn't open '%s' file", args.output_file);
+        }
+    }
+    size_t nb_injectable = 0;
+    for (size_t i = 0; i < nb_entries; i++) {
+        if (entries[i].size == -1) {
+            warnx("Warning: '%s' couldn't be scanned", entries[i].path);
+        }
+        else {
+            scan_entry_print(out, &entries[i]);
+            if ((entries[i].caps & CAP_INJECT_EP) == CAP_INJECT_EP) {
+                nb_injectable++;
+            }
+        }
+        scan_entry_free(&entries[i]);
+    }
+    free(entries);
+    if (out != stdout && fclose(out) == EOF) {
+        errx(EXIT_FAILURE, "Error: main: couldn't write '%s' file", args.output_file);
+    }
+
+    double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "isos-scan: %zu files scanned in %.3fs (%.0f files/s), %zu injectable, %d unreadable\n",
+            nb_entries, elapsed, (elapsed > 0) ? nb_entries / elapsed : 0.0, nb_injectable, total_failed);
+
+    return 0;
+}
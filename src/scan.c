@@ -0,0 +1,433 @@
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "elf_edit.h"
+#include "scan.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+// The state of the file being scanned, nothing is ever written
+struct scan_ctx
+{
+    int fd;
+    off_t size;
+    uint64_t hash;
+};
+
+static void hash_update(uint64_t *hash, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    for (size_t i = 0; i < len; i++) {
+        *hash ^= p[i];
+        *hash *= FNV_PRIME;
+    }
+}
+
+static void *read_at(struct scan_ctx *ctx, off_t offset, size_t len) {
+    // pread len bytes at offset in a new buffer, NULL if out of the file or on error
+    if (len == 0 || len > SCAN_MAX_READ || offset < 0 || offset > ctx->size || (off_t)len > ctx->size - offset) {
+        return NULL;
+    }
+    char *buf = malloc(len + 1);
+    if (buf == NULL) {
+        return NULL;
+    }
+    size_t done = 0;
+    while (done < len) {
+        ssize_t r = pread(ctx->fd, buf + done, len - done, offset + done);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            free(buf);
+            return NULL;
+        }
+        done += r;
+    }
+    // so that a string table can be used safely even if it isn't terminated
+    buf[len] = '\0';
+    hash_update(&ctx->hash, buf, len);
+    return buf;
+}
+
+static void *read_table(struct scan_ctx *ctx, const char *page, size_t page_len, off_t offset, size_t len) {
+    // the program and section headers are often in the first page we already read
+    if (offset >= 0 && (size_t)offset <= page_len && len <= page_len - offset) {
+        char *buf = malloc(len + 1);
+        if (buf != NULL) {
+            memcpy(buf, page + offset, len);
+            buf[len] = '\0';
+        }
+        return buf;
+    }
+    return read_at(ctx, offset, len);
+}
+
+static int find_sect(Elf64_Shdr *shdr, Elf64_Half nb_sect, const char *shstrtab, size_t shstrtab_len, const char *name) {
+    // same as get_sect_hdr_index, but sh_name is not trusted
+    for (int i = 0; i < nb_sect; i++) {
+        if (shdr[i].sh_name < shstrtab_len && strcmp(name, &shstrtab[shdr[i].sh_name]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static size_t escape_import(char *dst, const char *name) {
+    // write name in dst with '\n', '\t', '\\', ',' and '-' escaped, so that a name can't break the index line,
+    // the list of imports or be read as SCAN_NO_IMPORT. dst needs 2 * strlen(name) + 1 bytes. Return the length written
+    size_t len = 0;
+    for (const char *c = name; *c != '\0'; c++) {
+        switch (*c) {
+            case '\n':
+                dst[len++] = '\\';
+                dst[len++] = 'n';
+                break;
+            case '\t':
+                dst[len++] = '\\';
+                dst[len++] = 't';
+                break;
+            case '\\':
+            case ',':
+            case '-':
+                dst[len++] = '\\';
+                dst[len++] = *c;
+                break;
+            default:
+                dst[len++] = *c;
+                break;
+        }
+    }
+    dst[len] = '\0';
+    return len;
+}
+
+static const char *unescape_import_char(const char *cur, char *c) {
+    // read one character of an escaped import name in c, return where the next one starts or NULL if invalid
+    if (*cur != '\\') {
+        *c = *cur;
+        return cur + 1;
+    }
+    switch (cur[1]) {
+        case 'n':
+            *c = '\n';
+            break;
+        case 't':
+            *c = '\t';
+            break;
+        case '\\':
+        case ',':
+        case '-':
+            *c = cur[1];
+            break;
+        default:
+            return NULL;
+    }
+    return cur + 2;
+}
+
+static char *list_imports(struct scan_ctx *ctx, Elf64_Shdr *relaplt_hdr, Elf64_Shdr *dynsym_hdr, Elf64_Shdr *dynstr_hdr) {
+    // build the "name,name,..." list of the functions of .rela.plt, in the order used by replace_in_got
+    // the names are escaped by escape_import
+    if (relaplt_hdr->sh_entsize < sizeof(Elf64_Rela) || dynsym_hdr->sh_entsize < sizeof(Elf64_Sym)) {
+        return NULL;
+    }
+    size_t nb_relaplt = relaplt_hdr->sh_size / relaplt_hdr->sh_entsize;
+    size_t nb_dynsym = dynsym_hdr->sh_size / dynsym_hdr->sh_entsize;
+
+    char *relaplt = read_at(ctx, relaplt_hdr->sh_offset, relaplt_hdr->sh_size);
+    char *dynsym = read_at(ctx, dynsym_hdr->sh_offset, dynsym_hdr->sh_size);
+    char *dynstr = read_at(ctx, dynstr_hdr->sh_offset, dynstr_hdr->sh_size);
+    char *imports = NULL;
+    size_t len = 0;
+
+    if (relaplt == NULL || dynsym == NULL || dynstr == NULL) {
+        goto end;
+    }
+
+    for (size_t i = 0; i < nb_relaplt; i++) {
+        Elf64_Rela rela;
+        Elf64_Sym sym;
+        memcpy(&rela, relaplt + i * relaplt_hdr->sh_entsize, sizeof(rela));
+        size_t i_sym = ELF64_R_SYM(rela.r_info);
+        if (i_sym >= nb_dynsym) {
+            continue;
+        }
+        memcpy(&sym, dynsym + i_sym * dynsym_hdr->sh_entsize, sizeof(sym));
+        if (sym.st_name >= dynstr_hdr->sh_size) {
+            continue;
+        }
+        const char *name = &dynstr[sym.st_name];
+        size_t name_len = strlen(name);
+        if (name_len == 0) {
+            continue;
+        }
+
+        char *tmp = realloc(imports, len + 2 * name_len + 2);
+        if (tmp == NULL) {
+            free(imports);
+            imports = NULL;
+            goto end;
+        }
+        imports = tmp;
+        if (len > 0) {
+            imports[len++] = ',';
+        }
+        len += escape_import(imports + len, name);
+    }
+
+end:
+    free(relaplt);
+    free(dynsym);
+    free(dynstr);
+    return imports;
+}
+
+static void scan_sections(struct scan_ctx *ctx, Elf64_Ehdr *ehdr, const char *page, size_t page_len, struct scan_entry *entry) {
+    if (ehdr->e_shnum == 0 || ehdr->e_shstrndx >= ehdr->e_shnum || ehdr->e_shentsize != sizeof(Elf64_Shdr)) {
+        return;
+    }
+    Elf64_Shdr *shdr = read_table(ctx, page, page_len, ehdr->e_shoff, (size_t)ehdr->e_shnum * sizeof(Elf64_Shdr));
+    if (shdr == NULL) {
+        return;
+    }
+    Elf64_Shdr *shstrtab_hdr = &shdr[ehdr->e_shstrndx];
+    char *shstrtab = read_at(ctx, shstrtab_hdr->sh_offset, shstrtab_hdr->sh_size);
+    if (shstrtab == NULL) {
+        free(shdr);
+        return;
+    }
+    size_t shstrtab_len = shstrtab_hdr->sh_size;
+
+    if (find_sect(shdr, ehdr->e_shnum, shstrtab, shstrtab_len, SECTION_TO_REPLACE) != -1) {
+        entry->caps |= CAP_ABITAG;
+    }
+
+    int i_dynsym = find_sect(shdr, ehdr->e_shnum, shstrtab, shstrtab_len, SH_DYNTAB);
+    int i_gotplt = find_sect(shdr, ehdr->e_shnum, shstrtab, shstrtab_len, SH_GOTPLT);
+    int i_dynstr = find_sect(shdr, ehdr->e_shnum, shstrtab, shstrtab_len, SH_DYNSTR);
+    int i_relaplt = find_sect(shdr, ehdr->e_shnum, shstrtab, shstrtab_len, SH_RELAPLT);
+
+    if (i_dynsym != -1 && i_gotplt != -1 && i_dynstr != -1 && i_relaplt != -1) {
+        entry->caps |= CAP_GOT;
+        entry->imports = list_imports(ctx, &shdr[i_relaplt], &shdr[i_dynsym], &shdr[i_dynstr]);
+    }
+
+    free(shstrtab);
+    free(shdr);
+}
+
+// Read-only version of the checks made by isos-inject before patching a file.
+// Only the ELF header page and the few tables needed are read with pread.
+// Return 0 if the file has been scanned (even if it isn't an ELF file), -1 if it couldn't be read
+int scan_file(const char *path, struct scan_entry *entry) {
+    entry->size = 0;
+    entry->hash = FNV_OFFSET;
+    entry->caps = 0;
+    entry->imports = NULL;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    struct scan_ctx ctx = {.fd = fd, .size = file_stat.st_size, .hash = FNV_OFFSET};
+    entry->size = file_stat.st_size;
+
+    // the first page holds the ELF header and, most of the time, the program headers
+    char page[SCAN_PAGE];
+    ssize_t page_len = pread(fd, page, sizeof(page), 0);
+    if (page_len == -1) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)page_len < sizeof(Elf64_Ehdr)) {
+        close(fd);
+        return 0;
+    }
+    hash_update(&ctx.hash, page, page_len);
+
+    Elf64_Ehdr ehdr;
+    memcpy(&ehdr, page, sizeof(ehdr));
+
+    // is_ELF && is_64bit && is_executable of verifbin.c
+    if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 || ehdr.e_ident[EI_CLASS] != ELFCLASS64
+        || ehdr.e_ident[EI_DATA] != ELFDATA2LSB) {
+        close(fd);
+        return 0;
+    }
+    if (ehdr.e_machine == EM_X86_64 && ehdr.e_type == ET_EXEC) {
+        entry->caps |= CAP_EXEC;
+    }
+
+    if (ehdr.e_phnum > 0 && ehdr.e_phentsize == sizeof(Elf64_Phdr)) {
+        Elf64_Phdr *phdr = read_table(&ctx, page, page_len, ehdr.e_phoff, (size_t)ehdr.e_phnum * sizeof(Elf64_Phdr));
+        if (phdr != NULL) {
+            for (int i = 0; i < ehdr.e_phnum; i++) {
+                if (phdr[i].p_type == PT_NOTE) {
+                    entry->caps |= CAP_PTNOTE;
+                    break;
+                }
+            }
+            free(phdr);
+        }
+    }
+
+    scan_sections(&ctx, &ehdr, page, page_len, entry);
+
+    close(fd);
+    entry->hash = ctx.hash;
+    return 0;
+}
+
+void scan_entry_free(struct scan_entry *entry) {
+    free(entry->path);
+    free(entry->imports);
+    entry->path = NULL;
+    entry->imports = NULL;
+}
+
+void scan_path_print(FILE *out, const char *path) {
+    // '\n' would cut the line in two, so it is escaped, and '\\' too to be able to read it back
+    for (const char *c = path; *c != '\0'; c++) {
+        if (*c == '\n') {
+            fputs("\\n", out);
+        }
+        else if (*c == '\\') {
+            fputs("\\\\", out);
+        }
+        else {
+            fputc(*c, out);
+        }
+    }
+}
+
+static int unescape_path(char *path) {
+    // undo scan_path_print in place, return -1 on an unknown escape sequence
+    char *dst = path;
+    for (char *src = path; *src != '\0'; src++) {
+        if (*src == '\\') {
+            src++;
+            if (*src == 'n') {
+                *dst++ = '\n';
+            }
+            else if (*src == '\\') {
+                *dst++ = '\\';
+            }
+            else {
+                return -1;
+            }
+        }
+        else {
+            *dst++ = *src;
+        }
+    }
+    *dst = '\0';
+    return 0;
+}
+
+// One line per file: hash, size, caps, imports, path.
+// The path is last so that it can contain tabulations, its '\n' and '\\' are escaped.
+void scan_entry_print(FILE *out, const struct scan_entry *entry) {
+    fprintf(out, "%016" PRIx64 "\t%jd\t%c%c%c%c\t%s\t", entry->hash, (intmax_t)entry->size,
+            (entry->caps & CAP_EXEC) ? 'E' : '-',
+            (entry->caps & CAP_PTNOTE) ? 'P' : '-',
+            (entry->caps & CAP_ABITAG) ? 'N' : '-',
+            (entry->caps & CAP_GOT) ? 'G' : '-',
+            entry->imports != NULL ? entry->imports : SCAN_NO_IMPORT);
+    scan_path_print(out, entry->path);
+    fputc('\n', out);
+}
+
+// Parse a line written by scan_entry_print. The line is modified and the entry points inside it,
+// so scan_entry_free must not be called on it. Return -1 if the line is malformed
+int scan_entry_parse(char *line, struct scan_entry *entry) {
+    char *fields[4];
+    char *cur = line;
+    for (int i = 0; i < 4; i++) {
+        fields[i] = cur;
+        cur = strchr(cur, '\t');
+        if (cur == NULL) {
+            return -1;
+        }
+        *cur++ = '\0';
+    }
+    cur[strcspn(cur, "\n")] = '\0';
+
+    char *end;
+    errno = 0;
+    entry->hash = strtoull(fields[0], &end, 16);
+    if (*end != '\0' || errno != 0) {
+        return -1;
+    }
+    entry->size = strtoll(fields[1], &end, 10);
+    if (*end != '\0' || errno != 0) {
+        return -1;
+    }
+    if (strlen(fields[2]) != 4) {
+        return -1;
+    }
+    entry->caps = 0;
+    entry->caps |= (fields[2][0] == 'E') ? CAP_EXEC : 0;
+    entry->caps |= (fields[2][1] == 'P') ? CAP_PTNOTE : 0;
+    entry->caps |= (fields[2][2] == 'N') ? CAP_ABITAG : 0;
+    entry->caps |= (fields[2][3] == 'G') ? CAP_GOT : 0;
+    entry->imports = (strcmp(fields[3], SCAN_NO_IMPORT) == 0) ? NULL : fields[3];
+    // the imports stay escaped, they are only checked here
+    for (const char *c = entry->imports; c != NULL && *c != '\0';) {
+        char tmp;
+        c = unescape_import_char(c, &tmp);
+        if (c == NULL) {
+            return -1;
+        }
+    }
+    if (unescape_path(cur) == -1) {
+        return -1;
+    }
+    entry->path = cur;
+    return 0;
+}
+
+bool scan_entry_has_import(const struct scan_entry *entry, const char *func_name) {
+    // compare func_name to each escaped name of the list
+    const char *cur = entry->imports;
+    while (cur != NULL && *cur != '\0') {
+        const char *f = func_name;
+        bool match = true;
+        // an unescaped ',' ends the name
+        while (*cur != '\0' && *cur != ',') {
+            char c;
+            cur = unescape_import_char(cur, &c);
+            if (cur == NULL) {
+                return false;
+            }
+            if (match && *f == c) {
+                f++;
+            }
+            else {
+                match = false;
+            }
+        }
+        if (match && *f == '\0') {
+            return true;
+        }
+        if (*cur == ',') {
+            cur++;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,56 @@
+#include <argp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scanparser.h"
+
+struct argp_option scan_opts[] = {
+    {"output", 'o', "FILE", 0, "Write the index in FILE instead of the standard output", 0},
+    {"jobs", 'j', "UINT", 0, "The number of files scanned in parallel (default: number of cpus)", 0},
+    {"query", 'q', "INDEX", 0, "Do not scan, print the injectable files of an index previously created", 0},
+    {"dyn-func", 'd', "DYN_FUNC_NAME", 0, "With -q, only print the files where 'DYN_FUNC_NAME' can be hooked in the got", 0},
+    {"rescan", 'r', 0, 0, "With -q, read the headers of the files again and skip the ones whose hash changed (by default only the size is checked)", 0},
+    {0}
+};
+
+error_t parse_scan_opt(int k, char *arg, struct argp_state *state) {
+    // Take the current parsed argument
+    struct scan_arguments *argstruct = state->input;
+    switch (k) {
+        case 'o': {
+            argstruct->output_file = arg;
+            break;
+        }
+        case 'j': {
+            argstruct->jobs = arg;
+            break;
+        }
+        case 'q': {
+            argstruct->index_file = arg;
+            break;
+        }
+        case 'd': {
+            argstruct->func_to_replace = arg;
+            break;
+        }
+        case 'r': {
+            argstruct->rescan = true;
+            break;
+        }
+        case ARGP_KEY_ARGS:
+            argstruct->paths = &state->argv[state->next];
+            argstruct->nb_paths = state->argc - state->next;
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+struct argp scan_argp = {scan_opts, parse_scan_opt, "PATH...", "This program scans files and directories without modifying them "
+"and writes an index of the files 'isos-inject' can patch.\nEach line is: hash, size, capabilities, .rela.plt imports, path.\n"
+"In the path '\\n' and '\\\\' are escaped with a '\\', and in the imports '\\n', '\\t', '\\\\', ',' and '-' too.\n"
+"Capabilities: E = ELF64 executable, P = PT_NOTE segment, N = .note.ABI-tag section, G = got can be hooked.\n"
+"With -q INDEX, the files usable with -b 1 are printed, and with -q INDEX -d 'func_name' the files usable with -b 0 -d 'func_name'. "
+"The files whose size changed since the index was written are skipped.", 0, 0, 0};